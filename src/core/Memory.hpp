@@ -2,6 +2,7 @@
 #define MEMORY_HPP_
 
 #include <cstring>
+#include <cstdint>
 #include <memory>
 
 #ifdef __APPLE__
@@ -10,8 +11,29 @@
 #include <malloc.h>
 #endif
 
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
 namespace Tungsten {
 
+// Asks the kernel to back a large allocation with transparent huge pages,
+// cutting TLB pressure when render threads sweep it. Only the page-aligned
+// interior of the range is advised, so this is safe to call on any heap
+// allocation; on platforms without madvise it is a no-op
+inline void adviseHugePages(void *ptr, size_t size)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    uintptr_t begin = (uintptr_t(ptr) + 4095) & ~uintptr_t(4095);
+    uintptr_t end   = (uintptr_t(ptr) + size) & ~uintptr_t(4095);
+    if (begin < end)
+        madvise(reinterpret_cast<void *>(begin), end - begin, MADV_HUGEPAGE);
+#else
+    (void)ptr;
+    (void)size;
+#endif
+}
+
 template<typename T>
 inline std::unique_ptr<T[]> zeroAlloc(size_t size)
 {
@@ -5,6 +5,8 @@
 
 #include "math/Vec.hpp"
 
+#include "Memory.hpp"
+
 #include <memory>
 #include <atomic>
 
@@ -37,6 +39,9 @@ public:
       _filter(filter),
       _buffer(new Vec3fa[w*h])
     {
+        // The splat buffer is written from every render thread at random
+        // positions, so huge pages help keep its TLB footprint down
+        adviseHugePages(_buffer.get(), w*h*sizeof(Vec3fa));
         unsafeReset();
     }
     AtomicFramebuffer(AtomicFramebuffer &&o)
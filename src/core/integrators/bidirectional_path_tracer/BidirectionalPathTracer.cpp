@@ -2,7 +2,9 @@
 
 #include "integrators/bidirectional_path_tracer/ImagePyramid.hpp"
 
+#include <algorithm>
 #include <thread>
+#include <tuple>
 
 namespace Tungsten {
 
@@ -11,17 +13,27 @@ BidirectionalPathTracer::BidirectionalPathTracer(TraceableScene *scene, const Bi
 : TraceBase(scene, settings, threadId),
   _splatBuffer(scene->cam().splatBuffer()),
   _imagePyramid(imagePyramid),
-  _cameraPath(new LightPath(settings.maxBounces + 1)),
-  _emitterPath(new LightPath(settings.maxBounces + 1))
+  _cameraPath(settings.maxBounces + 1),
+  _emitterPath(settings.maxBounces + 1),
+  _strategyCapacity(0)
 {
     if (settings.imagePyramid)
         _directEmissionByBounce.reset(new Vec3f[settings.maxBounces + 2]);
 }
 
+void BidirectionalPathTracer::growStrategyScratch(int capacity)
+{
+    _strategies.reset(new ConnectionStrategy[capacity]);
+    _shadowRays.reset(new Ray[capacity]);
+    _rayIndex.reset(new int[capacity]);
+    _occlusion.reset(new uint8[capacity]);
+    _strategyCapacity = capacity;
+}
+
 Vec3f BidirectionalPathTracer::traceSample(Vec2u pixel, uint32 lightPathId, PathSampleGenerator &sampler)
 {
-    LightPath & cameraPath = * _cameraPath;
-    LightPath &emitterPath = *_emitterPath;
+    LightPath & cameraPath = _cameraPath;
+    LightPath &emitterPath = _emitterPath;
 
     float lightPdf;
     const Primitive *light = chooseLightAdjoint(sampler, lightPdf);
@@ -36,32 +48,109 @@ Vec3f BidirectionalPathTracer::traceSample(Vec2u pixel, uint32 lightPathId, Path
     int cameraLength =  cameraPath.length();
     int  lightLength = emitterPath.length();
 
+    // Vertex validity hoisted into dense flag arrays, so the strategy loop
+    // below tests one byte AND per (s, t) pair instead of re-reading the
+    // two vertices
+    uint8 *cameraValid  = reinterpret_cast<uint8 *>(alloca(max(cameraLength, 1)));
+    uint8 *emitterValid = reinterpret_cast<uint8 *>(alloca(max( lightLength, 1)));
+    for (int t = 0; t < cameraLength; ++t)
+        cameraValid[t] = cameraPath[t].connectable() ? 1 : 0;
+    for (int s = 0; s < lightLength; ++s)
+        emitterValid[s] = emitterPath[s].connectable() ? 1 : 0;
+
     Vec3f result = cameraPath.bdptWeightedPathEmission(_settings.minBounces + 2, _settings.maxBounces + 1, nullptr, _directEmissionByBounce.get());
 
     if (_imagePyramid)
         for (int t = 2; t <= cameraPath.length(); ++t)
             _imagePyramid->splat(0, t, pixel, _directEmissionByBounce[t - 2]);
 
+    // Breadth-first evaluation: enumerate the strategies surviving the
+    // validity tests for this sample first, then run the expensive
+    // connections in one dense sweep. This keeps the flag-testing loop
+    // tight and gives us a spot to reorder the surviving strategies
+    // before any shading work happens
+    if (lightLength*cameraLength > _strategyCapacity)
+        growStrategyScratch(lightLength*cameraLength);
+    ConnectionStrategy *strategies = _strategies.get();
+    int numStrategies = 0;
     for (int s = 1; s <= lightLength; ++s) {
         int upperBound = min(_settings.maxBounces - s + 1, cameraLength);
-        for (int t = 1; t <= upperBound; ++t) {
-            if (!cameraPath[t - 1].connectable() || !emitterPath[s - 1].connectable())
-                continue;
-
-            if (t == 1) {
-                Vec2f pixel;
-                Vec3f splatWeight;
-                if (LightPath::bdptCameraConnect(*this, cameraPath, emitterPath, s, _settings.maxBounces, sampler, splatWeight, pixel)) {
-                    _splatBuffer->splatFiltered(pixel, splatWeight);
-                    if (_imagePyramid)
-                        _imagePyramid->splatFiltered(s, t, pixel, splatWeight);
-                }
-            } else {
-                Vec3f v = LightPath::bdptConnect(*this, cameraPath, emitterPath, s, t, _settings.maxBounces, sampler);
-                result += v;
+        for (int t = 1; t <= upperBound; ++t)
+            if (cameraValid[t - 1] & emitterValid[s - 1])
+                strategies[numStrategies++] = ConnectionStrategy{s, t};
+    }
+
+    // Group strategies that evaluate the same BSDFs so their eval code
+    // runs back to back with warm instruction caches and branch
+    // predictors, mirroring the material sorting of wavefront tracers.
+    // The vertex sampler pointer stands in for a material ID, and (s, t)
+    // breaks ties to keep the order deterministic. This reorders which
+    // connection consumes which sampler draws, which is fine for an
+    // independent sample (the MLT integrators drive their connections
+    // directly and are unaffected)
+    auto shadingKey = [&](const ConnectionStrategy &c) {
+        return std::make_tuple(cameraPath[c.t - 1].bsdf(), emitterPath[c.s - 1].bsdf(), c.s, c.t);
+    };
+    std::sort(strategies, strategies + numStrategies,
+            [&](const ConnectionStrategy &a, const ConnectionStrategy &b) {
+        return shadingKey(a) < shadingKey(b);
+    });
+
+    // Batched occlusion pre-pass: the shadow rays of all surviving
+    // strategies are gathered up front and traced together through
+    // embree's ray stream API, which sorts them and amortizes BVH
+    // traversal across the batch. A segment the stream reports clear
+    // that also starts outside any medium is known to have unit
+    // transmittance and unit edge pdfs, so the per-connection
+    // generalized shadow walk below can be skipped for it. Occluded or
+    // in-medium segments fall back to the full walk, which handles
+    // punch-through transparency and medium pdfs
+    Ray *shadowRays = _shadowRays.get();
+    int *rayIndex = _rayIndex.get();
+    int numShadowRays = 0;
+    for (int i = 0; i < numStrategies; ++i) {
+        int s = strategies[i].s;
+        int t = strategies[i].t;
+        const PathVertex &a = emitterPath[s - 1];
+        const PathVertex &b = cameraPath[t - 1];
+
+        rayIndex[i] = -1;
+        int bounce = emitterPath.vertexIndex(s - 1) + cameraPath.vertexIndex(t - 1);
+        if (bounce >= _settings.maxBounces || bounce < _settings.minBounces)
+            continue;
+        if (b.isInfiniteSurface() || (s == 1 && a.emitter()->isInfinite()))
+            continue;
+
+        PathEdge edge(a, b);
+        if (t > 1 && (a.cosineFactor(edge.d) < 1e-5f || b.cosineFactor(edge.d) < 1e-5f))
+            continue;
+        if (a.selectMedium(edge.d))
+            continue;
+
+        rayIndex[i] = numShadowRays;
+        shadowRays[numShadowRays++] = Ray(a.pos(), edge.d, 1e-4f, edge.r*(1.0f - 1e-4f));
+    }
+    uint8 *occlusion = _occlusion.get();
+    _scene->occludedBatch(shadowRays, occlusion, numShadowRays);
+
+    for (int i = 0; i < numStrategies; ++i) {
+        int s = strategies[i].s;
+        int t = strategies[i].t;
+        bool knownUnoccluded = rayIndex[i] >= 0 && !occlusion[rayIndex[i]];
+
+        if (t == 1) {
+            Vec2f pixel;
+            Vec3f splatWeight;
+            if (LightPath::bdptCameraConnect(*this, cameraPath, emitterPath, s, _settings.maxBounces, sampler, splatWeight, pixel, nullptr, knownUnoccluded)) {
+                _splatBuffer->splatFiltered(pixel, splatWeight);
                 if (_imagePyramid)
-                    _imagePyramid->splat(s, t, pixel, v);
+                    _imagePyramid->splatFiltered(s, t, pixel, splatWeight);
             }
+        } else {
+            Vec3f v = LightPath::bdptConnect(*this, cameraPath, emitterPath, s, t, _settings.maxBounces, sampler, nullptr, knownUnoccluded);
+            result += v;
+            if (_imagePyramid)
+                _imagePyramid->splat(s, t, pixel, v);
         }
     }
     return result;
@@ -13,12 +13,32 @@ class PathVertex;
 
 class BidirectionalPathTracer : public TraceBase
 {
+    // One connection strategy selected for evaluation by traceSample:
+    // joins emitter vertex s - 1 to camera vertex t - 1
+    struct ConnectionStrategy
+    {
+        int s;
+        int t;
+    };
+
     AtomicFramebuffer *_splatBuffer;
     ImagePyramid *_imagePyramid;
 
     std::unique_ptr<Vec3f[]> _directEmissionByBounce;
-    std::unique_ptr<LightPath> _cameraPath;
-    std::unique_ptr<LightPath> _emitterPath;
+    LightPath _cameraPath;
+    LightPath _emitterPath;
+
+    // Scratch for the strategy sweep in traceSample. The strategy count
+    // grows quadratically with path length, which is too large for the
+    // stack at high bounce limits, so the tracer (which is per-thread
+    // already) keeps heap buffers that grow to the longest paths seen
+    std::unique_ptr<ConnectionStrategy[]> _strategies;
+    std::unique_ptr<Ray[]> _shadowRays;
+    std::unique_ptr<int[]> _rayIndex;
+    std::unique_ptr<uint8[]> _occlusion;
+    int _strategyCapacity;
+
+    void growStrategyScratch(int capacity);
 
 public:
     BidirectionalPathTracer(TraceableScene *scene, const BidirectionalPathTracerSettings &settings,
@@ -3,6 +3,8 @@
 #include "integrators/TraceState.hpp"
 #include "integrators/TraceBase.hpp"
 
+#include "math/BitManip.hpp"
+
 #include "primitives/Primitive.hpp"
 
 #include "renderer/TraceableScene.hpp"
@@ -91,6 +93,17 @@ void LightPath::toAreaMeasure()
             _vertices[i].pdfBackward() *= _vertices[i].cosineFactor(_edges[i].d);
         _vertices[i].pdfBackward() /= _edges[i].rSq;
     }
+
+    refreshSoA();
+}
+
+void LightPath::refreshSoA()
+{
+    for (int i = 0; i < _length; ++i) {
+        _soa.setPdfForward (i, _vertices[i].pdfForward());
+        _soa.setPdfBackward(i, _vertices[i].pdfBackward());
+        _soa.nonDirac(i) = _vertices[i].isDirac() ? 0 : 1;
+    }
 }
 
 float LightPath::misWeight(const LightPath &camera, const LightPath &emitter,
@@ -105,15 +118,15 @@ float LightPath::misWeight(const LightPath &camera, const LightPath &emitter,
         return 0.0f;
 
     for (int i = 0; i < s; ++i) {
-        pdfForward [i] = emitter[i].pdfForward();
-        pdfBackward[i] = emitter[i].pdfBackward();
-        connectable[i] = !emitter[i].isDirac();
+        pdfForward [i] = emitter._soa.pdfForward (i);
+        pdfBackward[i] = emitter._soa.pdfBackward(i);
+        connectable[i] = emitter._soa.nonDirac(i) != 0;
         vertices   [i] = &emitter[i];
     }
     for (int i = 0; i < t; ++i) {
-        pdfForward [s + t - (i + 1)] = camera[i].pdfBackward();
-        pdfBackward[s + t - (i + 1)] = camera[i].pdfForward();
-        connectable[s + t - (i + 1)] = !camera[i].isDirac();
+        pdfForward [s + t - (i + 1)] = camera._soa.pdfBackward(i);
+        pdfBackward[s + t - (i + 1)] = camera._soa.pdfForward (i);
+        connectable[s + t - (i + 1)] = camera._soa.nonDirac(i) != 0;
         vertices   [s + t - (i + 1)] = &camera[i];
     }
     connectable[s - 1] = connectable[s] = true;
@@ -137,35 +150,47 @@ float LightPath::misWeight(const LightPath &camera, const LightPath &emitter,
         if (connectable[i] && !connectable[i - 1])
             pdfBackward[i - 1] *= (i < s) ? emitter.invGeometryFactor(i - 1) : camera.invGeometryFactor(s + t - 1 - i);
 
+    // The pdf ratios the accumulation below multiplies up are divided out
+    // here in one independent unit-stride sweep, so the serial pi chain is
+    // pure multiplies and the divisions don't sit on its critical path.
+    // Entries whose divisor can be zero are only read where the original
+    // per-iteration division read them too
+    float *fwdOverBwd = reinterpret_cast<float *>(alloca((s + t)*sizeof(float)));
+    float *bwdOverFwd = reinterpret_cast<float *>(alloca((s + t)*sizeof(float)));
+    for (int i = 0; i < s + t; ++i) {
+        fwdOverBwd[i] = pdfForward [i]/pdfBackward[i];
+        bwdOverFwd[i] = pdfBackward[i]/pdfForward [i];
+    }
+
+    // Validity of each candidate technique as an all-ones/all-zero float
+    // mask, so the accumulation chains apply it with bit arithmetic
+    // instead of branching on vertex validity every iteration
+    uint32 *validMask = reinterpret_cast<uint32 *>(alloca((s + t)*sizeof(uint32)));
+    for (int i = 1; i < s + t; ++i)
+        validMask[i] = (connectable[i - 1] && connectable[i]
+                && vertices[i - 1]->segmentConnectable(*vertices[i])) ? 0xFFFFFFFFu : 0u;
+
     float weight = 1.0f;
     float pi = 1.0f;
     if (ratios)
         ratios[s] = 1.0f;
     for (int i = s + 1; i < s + t; ++i) {
-        pi *= pdfForward[i - 1]/pdfBackward[i - 1];
-        if (connectable[i - 1] && connectable[i] && vertices[i - 1]->segmentConnectable(*vertices[i])) {
-            weight += pi;
-            if (ratios)
-                ratios[i] = pi;
-        } else {
-            if (ratios)
-                ratios[i] = 0.0f;
-        }
+        pi *= fwdOverBwd[i - 1];
+        float contrib = BitManip::uintBitsToFloat(BitManip::floatBitsToUint(pi) & validMask[i]);
+        weight += contrib;
+        if (ratios)
+            ratios[i] = contrib;
     }
     pi = 1.0f;
     for (int i = s - 1; i >= 1; --i) {
-        pi *= pdfBackward[i]/pdfForward[i];
-        if (connectable[i - 1] && connectable[i] && vertices[i - 1]->segmentConnectable(*vertices[i])) {
-            weight += pi;
-            if (ratios)
-                ratios[i] = pi;
-        } else {
-            if (ratios)
-                ratios[i] = 0.0f;
-        }
+        pi *= bwdOverFwd[i];
+        float contrib = BitManip::uintBitsToFloat(BitManip::floatBitsToUint(pi) & validMask[i]);
+        weight += contrib;
+        if (ratios)
+            ratios[i] = contrib;
     }
     if (!emitter[0].emitter()->isDirac()) {
-        pi *= pdfBackward[0]/pdfForward[0];
+        pi *= bwdOverFwd[0];
         weight += pi;
         if (ratios)
             ratios[0] = pi;
@@ -216,13 +241,15 @@ void LightPath::copy(const LightPath &o)
     _maxVertices = o._maxVertices;
     _length      = o._length;
     _adjoint     = o._adjoint;
-    std::memcpy(_vertexIndex.get(), o._vertexIndex.get(), _maxVertices*sizeof(_vertexIndex[0]));
-    std::memcpy(_vertices   .get(), o._vertices   .get(), _maxVertices*sizeof(_vertices   [0]));
-    std::memcpy(_edges      .get(), o._edges      .get(), _maxVertices*sizeof(_edges      [0]));
+    std::memcpy(_vertexIndex, o._vertexIndex, _maxVertices*sizeof(_vertexIndex[0]));
+    std::memcpy(_vertices,    o._vertices,    _maxVertices*sizeof(_vertices   [0]));
+    std::memcpy(_edges,       o._edges,       _maxVertices*sizeof(_edges      [0]));
 
     for (int i = 0; i < _maxVertices; ++i)
         if (_vertices[i].onSurface())
             _vertices[i].pointerFixup();
+
+    refreshSoA();
 }
 
 Vec3f LightPath::bdptWeightedPathEmission(int minLength, int maxLength, float *ratios, Vec3f *directEmissionByBounce) const
@@ -231,6 +258,7 @@ Vec3f LightPath::bdptWeightedPathEmission(int minLength, int maxLength, float *r
 
     float *pdfForward  = reinterpret_cast<float *>(alloca(_length*sizeof(float)));
     float *pdfBackward = reinterpret_cast<float *>(alloca(_length*sizeof(float)));
+    float *fwdOverBwd  = reinterpret_cast<float *>(alloca(_length*sizeof(float)));
     bool  *connectable = reinterpret_cast<bool  *>(alloca(_length*sizeof(bool)));
 
     if (directEmissionByBounce)
@@ -264,9 +292,9 @@ Vec3f LightPath::bdptWeightedPathEmission(int minLength, int maxLength, float *r
         }
 
         for (int i = 0; i < t; ++i) {
-            pdfForward [t - (i + 1)] = _vertices[i].pdfBackward();
-            pdfBackward[t - (i + 1)] = _vertices[i].pdfForward();
-            connectable[t - (i + 1)] = !_vertices[i].isDirac();
+            pdfForward [t - (i + 1)] = _soa.pdfBackward(i);
+            pdfBackward[t - (i + 1)] = _soa.pdfForward (i);
+            connectable[t - (i + 1)] = _soa.nonDirac(i) != 0;
         }
         connectable[0] = true;
 
@@ -295,12 +323,15 @@ Vec3f LightPath::bdptWeightedPathEmission(int minLength, int maxLength, float *r
             if (connectable[i] && !connectable[i - 1])
                 pdfBackward[i - 1] *= invGeometryFactor(t - 1 - i);
 
+        for (int i = 0; i < t - 1; ++i)
+            fwdOverBwd[i] = pdfForward[i]/pdfBackward[i];
+
         float weight = 1.0f;
         float pi = 1.0f;
         if (ratios)
             ratios[0] = 1.0f;
         for (int i = 1; i < t; ++i) {
-            pi *= pdfForward[i - 1]/pdfBackward[i - 1];
+            pi *= fwdOverBwd[i - 1];
             if (connectable[i - 1] && connectable[i]) {
                 weight += pi;
                 if (ratios)
@@ -321,7 +352,7 @@ Vec3f LightPath::bdptWeightedPathEmission(int minLength, int maxLength, float *r
 }
 
 Vec3f LightPath::bdptConnect(const TraceBase &tracer, const LightPath &camera, const LightPath &emitter,
-        int s, int t, int maxBounce, PathSampleGenerator &sampler, float *ratios)
+        int s, int t, int maxBounce, PathSampleGenerator &sampler, float *ratios, bool knownUnoccluded)
 {
     const PathVertex &a = emitter[s - 1];
     const PathVertex &b = camera[t - 1];
@@ -354,11 +385,18 @@ Vec3f LightPath::bdptConnect(const TraceBase &tracer, const LightPath &camera, c
         // Catch the case where both vertices land on the same surface
         if (a.cosineFactor(edge.d) < 1e-5f || b.cosineFactor(edge.d) < 1e-5f)
             return Vec3f(0.0f);
-        Ray ray(a.pos(), edge.d, 1e-4f, edge.r*(1.0f - 1e-4f));
-        Vec3f transmittance = tracer.generalizedShadowRayAndPdfs(sampler, ray, a.selectMedium(edge.d), nullptr,
-                bounce, a.onSurface(), b.onSurface(), edge.pdfForward, edge.pdfBackward);
-        if (transmittance == 0.0f)
-            return Vec3f(0.0f);
+        const Medium *medium = a.selectMedium(edge.d);
+        Vec3f transmittance(1.0f);
+        if (!knownUnoccluded || medium) {
+            // A segment reported clear by the occlusion pre-pass and free of
+            // media is known to have unit transmittance and unit edge pdfs,
+            // so the shadow walk only runs when one of those can attenuate
+            Ray ray(a.pos(), edge.d, 1e-4f, edge.r*(1.0f - 1e-4f));
+            transmittance = tracer.generalizedShadowRayAndPdfs(sampler, ray, medium, nullptr,
+                    bounce, a.onSurface(), b.onSurface(), edge.pdfForward, edge.pdfBackward);
+            if (transmittance == 0.0f)
+                return Vec3f(0.0f);
+        }
 
         Vec3f unweightedContrib = transmittance*a.throughput()*a.eval(edge.d, true)*b.eval(-edge.d, false)*b.throughput()/edge.rSq;
 
@@ -367,7 +405,8 @@ Vec3f LightPath::bdptConnect(const TraceBase &tracer, const LightPath &camera, c
 }
 
 bool LightPath::bdptCameraConnect(const TraceBase &tracer, const LightPath &camera, const LightPath &emitter,
-        int s, int maxBounce, PathSampleGenerator &sampler, Vec3f &weight, Vec2f &pixel, float *ratios)
+        int s, int maxBounce, PathSampleGenerator &sampler, Vec3f &weight, Vec2f &pixel, float *ratios,
+        bool knownUnoccluded)
 {
     const PathVertex &a = emitter[s - 1];
     const PathVertex &b = camera[0];
@@ -381,11 +420,15 @@ bool LightPath::bdptCameraConnect(const TraceBase &tracer, const LightPath &came
         return false;
 
     PathEdge edge(a, b);
-    Ray ray(a.pos(), edge.d, 1e-4f, edge.r*(1.0f - 1e-4f));
-    Vec3f transmittance = tracer.generalizedShadowRayAndPdfs(sampler, ray, a.selectMedium(edge.d), nullptr,
-            bounce, a.onSurface(), b.onSurface(), edge.pdfForward, edge.pdfBackward);
-    if (transmittance == 0.0f)
-        return false;
+    const Medium *medium = a.selectMedium(edge.d);
+    Vec3f transmittance(1.0f);
+    if (!knownUnoccluded || medium) {
+        Ray ray(a.pos(), edge.d, 1e-4f, edge.r*(1.0f - 1e-4f));
+        transmittance = tracer.generalizedShadowRayAndPdfs(sampler, ray, medium, nullptr,
+                bounce, a.onSurface(), b.onSurface(), edge.pdfForward, edge.pdfBackward);
+        if (transmittance == 0.0f)
+            return false;
+    }
 
     Vec3f splatWeight;
     if (!b.camera()->evalDirection(sampler, b.cameraRecord().point, DirectionSample(-edge.d), splatWeight, pixel))
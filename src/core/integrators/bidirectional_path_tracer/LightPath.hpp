@@ -4,24 +4,93 @@
 #include "PathVertex.hpp"
 #include "PathEdge.hpp"
 
+#include "math/BitManip.hpp"
+
+#include "Memory.hpp"
+
 #include <memory>
+#include <new>
 
 namespace Tungsten {
 
+// Blocked structure-of-arrays mirror of the PathVertex fields that the MIS
+// weight computation sweeps over. PathVertex is large (it embeds a union of
+// all vertex records), so gathering pdfForward/pdfBackward/isDirac for every
+// vertex of a path from the AoS layout touches one cache line per vertex
+// and wastes most of it. The mirror groups the hot fields into blocks of
+// BlockSize vertices: within a block each field is contiguous (unit-stride,
+// vectorizable), while all fields of a block still share one or two cache
+// lines, so sweeps that read several fields per vertex don't pay one
+// prefetch stream per field.
+//
+// The pdfs are stored as bfloat16 bit patterns, halving the mirror's
+// footprint. The MIS sweep only consumes ratios of these values to weight
+// a contribution, so bf16's 8 mantissa bits are plenty there; the full
+// precision pdfs used for sampling stay on the vertices themselves
+struct PathVertexSoA
+{
+    // One SSE lane count's worth of vertices per block, matching the
+    // highest ISA the build targets.
+    static CONSTEXPR int BlockSize = 4;
+
+    struct Block
+    {
+        uint16 pdfForward [BlockSize];
+        uint16 pdfBackward[BlockSize];
+        uint8  nonDirac   [BlockSize];
+    };
+
+    // Storage lives in the owning LightPath's arena
+    Block *blocks = nullptr;
+
+    float pdfForward(int i) const
+    {
+        return BitManip::bf16ToFloat(blocks[i/BlockSize].pdfForward[i % BlockSize]);
+    }
+    void setPdfForward(int i, float f)
+    {
+        blocks[i/BlockSize].pdfForward[i % BlockSize] = BitManip::floatToBf16(f);
+    }
+    float pdfBackward(int i) const
+    {
+        return BitManip::bf16ToFloat(blocks[i/BlockSize].pdfBackward[i % BlockSize]);
+    }
+    void setPdfBackward(int i, float f)
+    {
+        blocks[i/BlockSize].pdfBackward[i % BlockSize] = BitManip::floatToBf16(f);
+    }
+    uint8 &nonDirac(int i)
+    {
+        return blocks[i/BlockSize].nonDirac[i % BlockSize];
+    }
+    uint8 nonDirac(int i) const
+    {
+        return blocks[i/BlockSize].nonDirac[i % BlockSize];
+    }
+};
+
 class LightPath
 {
     int _maxLength;
     int _maxVertices;
     int _length;
     bool _adjoint;
-    std::unique_ptr<int[]> _vertexIndex;
-    std::unique_ptr<PathVertex[]> _vertices;
-    std::unique_ptr<PathEdge[]> _edges;
+    aligned_unique_ptr<uint8> _arena;
+    int *_vertexIndex;
+    PathVertex *_vertices;
+    PathEdge *_edges;
+    PathVertexSoA _soa;
+
+    static size_t alignSize(size_t size)
+    {
+        return (size + 63) & ~size_t(63);
+    }
 
     float geometryFactor(int startVertex) const;
     float invGeometryFactor(int startVertex) const;
 
     void toAreaMeasure();
+    void refreshSoA();
 
     static float misWeight(const LightPath &camera, const LightPath &emitter,
             const PathEdge &edge, int s, int t, float *ratios);
@@ -31,11 +100,31 @@ public:
     : _maxLength(maxLength),
       _maxVertices(maxLength + 4),
       _length(0),
-      _adjoint(false),
-      _vertexIndex(new int[_maxVertices]),
-      _vertices(new PathVertex[_maxVertices]),
-      _edges(new PathEdge[_maxVertices])
+      _adjoint(false)
     {
+        // All per-vertex storage is carved from one cache-aligned arena
+        // slab instead of one heap allocation per array. This keeps the
+        // vertices, edges and the SoA mirror of a path (and, since the
+        // tracers own their paths by value, of a whole worker thread)
+        // contiguous in memory
+        size_t numBlocks = (_maxVertices + PathVertexSoA::BlockSize - 1)/PathVertexSoA::BlockSize;
+        size_t soaOffset  = 0;
+        size_t vertOffset = soaOffset  + alignSize(numBlocks*sizeof(PathVertexSoA::Block));
+        size_t edgeOffset = vertOffset + alignSize(_maxVertices*sizeof(PathVertex));
+        size_t idxOffset  = edgeOffset + alignSize(_maxVertices*sizeof(PathEdge));
+        size_t arenaSize = idxOffset + _maxVertices*sizeof(int);
+        _arena = alignedAlloc<uint8>(arenaSize, 64);
+        adviseHugePages(_arena.get(), arenaSize);
+
+        _soa.blocks  = reinterpret_cast<PathVertexSoA::Block *>(_arena.get() + soaOffset);
+        _vertices    = reinterpret_cast<PathVertex *>(_arena.get() + vertOffset);
+        _edges       = reinterpret_cast<PathEdge   *>(_arena.get() + edgeOffset);
+        _vertexIndex = reinterpret_cast<int        *>(_arena.get() + idxOffset);
+
+        for (int i = 0; i < _maxVertices; ++i) {
+            new (&_vertices[i]) PathVertex();
+            new (&_edges   [i]) PathEdge();
+        }
     }
 
     void clear()
@@ -112,10 +201,16 @@ public:
 
     Vec3f bdptWeightedPathEmission(int minLength, int maxLength, float *ratios = nullptr, Vec3f *directEmissionByBounce = nullptr) const;
 
+    // knownUnoccluded may be set by callers that have already occlusion-tested
+    // the connecting segment (e.g. through TraceableScene::occludedBatch) and
+    // found it clear, in which case the generalized shadow walk can be skipped
+    // for segments that don't pass through a medium
     static Vec3f bdptConnect(const TraceBase &tracer, const LightPath &camera, const LightPath &emitter,
-            int s, int t, int maxBounce, PathSampleGenerator &sampler, float *ratios = nullptr);
+            int s, int t, int maxBounce, PathSampleGenerator &sampler, float *ratios = nullptr,
+            bool knownUnoccluded = false);
     static bool bdptCameraConnect(const TraceBase &tracer, const LightPath &camera, const LightPath &emitter,
-            int s, int maxBounce, PathSampleGenerator &sampler, Vec3f &weight, Vec2f &pixel, float *ratios = nullptr);
+            int s, int maxBounce, PathSampleGenerator &sampler, Vec3f &weight, Vec2f &pixel, float *ratios = nullptr,
+            bool knownUnoccluded = false);
 
     bool extendSampleSpace(WritablePathSampleGenerator &sampler, const LightPath &source, int numVerts) const;
 
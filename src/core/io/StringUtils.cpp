@@ -2,9 +2,8 @@
 
 #include "IntTypes.hpp"
 
-#include <tinyformat/tinyformat.hpp>
 #include <cstdlib>
-#include <sstream>
+#include <cstdio>
 #include <cctype>
 
 namespace Tungsten {
@@ -56,15 +55,19 @@ std::string durationToString(double secs)
     uint64 days = hours/24;
     double fraction = secs - seconds;
 
-    std::stringstream ss;
+    // This gets called from per-batch logging, so format into a fixed
+    // buffer instead of paying for stringstream construction every time
+    char buffer[64];
+    int pos = 0;
 
-    if (days)    ss << tfm::format("%dd ", days);
-    if (hours)   ss << tfm::format("%dh ", hours % 24);
-    if (minutes) ss << tfm::format("%dm ", minutes % 60);
-    if (seconds) ss << tfm::format("%ds %dms", seconds % 60, uint64(fraction*1000.0f) % 1000);
-    else ss << secs << "s";
+    if (days)    pos += std::snprintf(buffer + pos, sizeof(buffer) - pos, "%llud ", (unsigned long long)(days));
+    if (hours)   pos += std::snprintf(buffer + pos, sizeof(buffer) - pos, "%lluh ", (unsigned long long)(hours % 24));
+    if (minutes) pos += std::snprintf(buffer + pos, sizeof(buffer) - pos, "%llum ", (unsigned long long)(minutes % 60));
+    if (seconds) pos += std::snprintf(buffer + pos, sizeof(buffer) - pos, "%llus %llums",
+            (unsigned long long)(seconds % 60), (unsigned long long)(uint64(fraction*1000.0f) % 1000));
+    else pos += std::snprintf(buffer + pos, sizeof(buffer) - pos, "%gs", secs);
 
-    return std::move(ss.str());
+    return std::string(buffer, pos);
 }
 
 }
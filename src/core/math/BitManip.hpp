@@ -49,6 +49,23 @@ public:
         return uintBitsToFloat((i >> 9u) | 0x3F800000u) - 1.0f;
     }
 
+    // Conversion to and from bfloat16 - the upper 16 bits of an IEEE
+    // float, keeping its full exponent range but only 8 mantissa bits.
+    // Useful for halving the storage of quantities where half a percent
+    // of relative error is acceptable
+    static inline uint16 floatToBf16(float f)
+    {
+        uint32 bits = floatBitsToUint(f);
+        // Round to nearest even instead of truncating
+        bits += 0x7FFFu + ((bits >> 16) & 1u);
+        return uint16(bits >> 16);
+    }
+
+    static inline float bf16ToFloat(uint16 h)
+    {
+        return uintBitsToFloat(uint32(h) << 16);
+    }
+
 #if defined(__GNUC__)
     static inline uint32 msb(uint32 x)
     {
@@ -14,6 +14,7 @@
 #include "media/Medium.hpp"
 
 #include "RendererSettings.hpp"
+#include "Debug.hpp"
 #include <vector>
 #include <memory>
 
@@ -131,6 +132,14 @@ public:
             });
 
             rtcCommit(_scene);
+
+            // Embree reports failures (e.g. features the scene flags don't
+            // support) through its error callback and otherwise carries on,
+            // which surfaces later as crashes deep inside traversal. Fail
+            // loudly at setup instead
+            RTCError error = rtcDeviceGetError(EmbreeUtil::getDevice());
+            if (error != RTC_NO_ERROR)
+                FAIL("Embree scene setup failed with error code %i", int(error));
         }
 
         _integrator.prepareForRender(*this, seed);
@@ -222,6 +231,18 @@ public:
         }
     }
 
+    // Occlusion-tests a whole batch of rays, setting occlusion[i] to 1 if
+    // anything intersects rays[i]. Embree's stream API (rtcOccluded1M)
+    // would let the batch share traversal work, but embree 2 rejects the
+    // scalar user geometry callbacks the scene is built from when stream
+    // support is requested, so the rays are traced individually; the
+    // batch interface keeps callers ready for a stream-capable backend
+    void occludedBatch(const Ray *rays, uint8 *occlusion, int count) const
+    {
+        for (int i = 0; i < count; ++i)
+            occlusion[i] = occluded(rays[i]) ? 1 : 0;
+    }
+
     const Box3f &bounds() const
     {
         return _sceneBounds;
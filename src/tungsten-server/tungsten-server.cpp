@@ -6,11 +6,8 @@
 #else
 #include <unistd.h>
 #endif
-#include <rapidjson/stringbuffer.h>
-#include <rapidjson/writer.h>
 #include <lodepng/lodepng.h>
 #include <civetweb/civetweb.h>
-#include <sstream>
 
 using namespace Tungsten;
 
@@ -20,8 +17,7 @@ static const int OPT_LOGFILE = 101;
 static struct mg_context *context = nullptr;
 static StandaloneRenderer *renderer = nullptr;
 
-static std::mutex logMutex;
-static std::ostringstream logStream;
+static RenderLog renderLog;
 
 enum MimeType
 {
@@ -67,11 +63,7 @@ void closeConnection()
 
 int serveLogFile(struct mg_connection *conn, void * /*cbdata*/)
 {
-    std::string log;
-    if (renderer) {
-        std::unique_lock<std::mutex> lock(renderer->logMutex());
-        log = logStream.str();
-    }
+    std::string log = renderLog.contents();
     serveData(conn, reinterpret_cast<const void *>(log.c_str()), log.size(), MIME_TEXT);
 
     return 1;
@@ -79,20 +71,13 @@ int serveLogFile(struct mg_connection *conn, void * /*cbdata*/)
 
 int serveStatusJson(struct mg_connection *conn, void * /*cbdata*/)
 {
-    std::string statusString;
-    if (renderer) {
-        RendererStatus status = renderer->status();
-        rapidjson::Document document;
-
-        *(static_cast<rapidjson::Value *>(&document)) = status.toJson(document.GetAllocator());
-
-        rapidjson::GenericStringBuffer<rapidjson::UTF8<>> buffer;
-        rapidjson::Writer<rapidjson::GenericStringBuffer<rapidjson::UTF8<>>> jsonWriter(buffer);
-        document.Accept(jsonWriter);
-
-        statusString = buffer.GetString();
-    }
-    serveData(conn, reinterpret_cast<const void *>(statusString.c_str()), statusString.size(), MIME_JSON);
+    std::shared_ptr<const std::string> statusString;
+    if (renderer)
+        statusString = renderer->statusJson();
+    if (statusString)
+        serveData(conn, reinterpret_cast<const void *>(statusString->c_str()), statusString->size(), MIME_JSON);
+    else
+        serveData(conn, reinterpret_cast<const void *>(""), 0, MIME_JSON);
 
     return 1;
 }
@@ -126,7 +111,7 @@ int main(int argc, const char *argv[])
     parser.addOption('p', "port", "Port to listen on. Defaults to 8080", true, OPT_PORT);
     parser.addOption('l', "log-file", "Specifies a file to save the render log to", true, OPT_LOGFILE);
 
-    renderer = new StandaloneRenderer(parser, logStream);
+    renderer = new StandaloneRenderer(parser, renderLog);
 
     parser.parse(argc, argv);
 
@@ -168,7 +153,7 @@ int main(int argc, const char *argv[])
     if (!logFile.empty()) {
         OutputStreamHandle out = FileUtils::openOutputStream(logFile);
         if (out)
-            *out << logStream.str();
+            *out << renderLog.contents();
         else
             std::cerr << "Unable to open log file at " << logFile << " to write to" << std::endl;
     }
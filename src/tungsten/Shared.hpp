@@ -15,12 +15,21 @@
 #include "io/CliParser.hpp"
 #include "io/Scene.hpp"
 
+#include "Memory.hpp"
 #include "Timer.hpp"
 
 #include <tinyformat/tinyformat.hpp>
+#include <rapidjson/stringbuffer.h>
 #include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <immintrin.h>
 #include <cstdlib>
+#include <cstring>
+#include <atomic>
 #include <vector>
+#include <thread>
+#include <chrono>
+#include <array>
 #include <mutex>
 #include <deque>
 
@@ -58,6 +67,122 @@ static const char *renderStateToString(RenderState state)
     }
 }
 
+// Log sink for the standalone renderer. Producers (render threads, the
+// status thread) drop each line into a bounded ring of preallocated
+// slots with one atomic fetch_add and one release store - no lock, no
+// stream formatting, no flush. A dedicated consumer thread drains the
+// ring at its own pace, appends to one contiguous buffer for readers
+// (the /log endpoint, the end-of-run log file dump) and mirrors lines
+// to an optional ostream for console output with one flush per batch
+class RenderLog
+{
+    static CONSTEXPR int SlotCount = 1024;
+
+    struct LogSlot
+    {
+        std::atomic<uint64> seq;
+        std::string msg;
+    };
+
+    std::array<LogSlot, SlotCount> _slots;
+    std::atomic<uint64> _head;
+    std::atomic<bool> _shutdown;
+    uint64 _tail;
+
+    mutable std::mutex _bufferMutex;
+    std::mutex _drainMutex;
+    std::string _buffer;
+    std::ostream *_tee;
+    std::thread _consumer;
+
+    // Moves all published slots into the contiguous buffer and the tee
+    // stream. Normally only the consumer thread gets here; readers that
+    // want an up-to-date snapshot drain explicitly, hence the mutex
+    void drain()
+    {
+        std::unique_lock<std::mutex> drainLock(_drainMutex);
+
+        std::string batch;
+        for (;;) {
+            LogSlot &slot = _slots[_tail % SlotCount];
+            if (slot.seq.load(std::memory_order_acquire) != _tail + 1)
+                break;
+            batch.append(slot.msg);
+            batch.push_back('\n');
+            slot.msg.clear();
+            slot.seq.store(_tail + SlotCount, std::memory_order_release);
+            _tail++;
+        }
+        if (batch.empty())
+            return;
+
+        {
+            std::unique_lock<std::mutex> lock(_bufferMutex);
+            _buffer.append(batch);
+        }
+        if (_tee) {
+            (*_tee) << batch;
+            _tee->flush();
+        }
+    }
+
+    void consumeLoop()
+    {
+        for (;;) {
+            bool done = _shutdown.load(std::memory_order_acquire);
+            drain();
+            if (done)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+
+public:
+    explicit RenderLog(std::ostream *tee = nullptr)
+    : _head(0),
+      _shutdown(false),
+      _tail(0),
+      _tee(tee)
+    {
+        for (int i = 0; i < SlotCount; ++i)
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+        _consumer = std::thread(&RenderLog::consumeLoop, this);
+    }
+
+    ~RenderLog()
+    {
+        _shutdown.store(true, std::memory_order_release);
+        if (_consumer.joinable())
+            _consumer.join();
+    }
+
+    void writeLine(std::string s)
+    {
+        uint64 pos = _head.fetch_add(1, std::memory_order_relaxed);
+        LogSlot &slot = _slots[pos % SlotCount];
+        // Only happens when producers lap the consumer by a full ring -
+        // wait for the slot to drain rather than dropping the line
+        while (slot.seq.load(std::memory_order_acquire) != pos)
+            std::this_thread::yield();
+        slot.msg = std::move(s);
+        slot.seq.store(pos + 1, std::memory_order_release);
+    }
+
+    // Readers can poll this without touching the buffer to check for
+    // new lines since the last snapshot they took
+    uint64 sequence() const
+    {
+        return _head.load(std::memory_order_relaxed);
+    }
+
+    std::string contents()
+    {
+        drain();
+        std::unique_lock<std::mutex> lock(_bufferMutex);
+        return _buffer;
+    }
+};
+
 struct RendererStatus
 {
     RenderState state;
@@ -77,18 +202,38 @@ struct RendererStatus
             "start_spp", startSpp,
             "current_spp", currentSpp,
             "next_spp", nextSpp,
-            "total_spp", totalSpp,
-            "current_scene", currentScene
+            "total_spp", totalSpp
         };
         rapidjson::Value completedValue(rapidjson::kArrayType);
         rapidjson::Value queuedValue(rapidjson::kArrayType);
 
+        // All path strings are concatenated into one scratch block from
+        // the document allocator and referenced in place, so building
+        // the document costs a single string allocation no matter how
+        // many scenes a batch render has queued, and the referenced
+        // strings live exactly as long as the document does
+        size_t totalLength = currentScene.asString().size();
+        for (const Path &p : completedScenes)
+            totalLength += p.asString().size();
+        for (const Path &p : queuedScenes)
+            totalLength += p.asString().size();
+
+        char *scratch = static_cast<char *>(allocator.Malloc(totalLength));
+        auto pathRef = [&scratch](const Path &p) {
+            const std::string &s = p.asString();
+            std::memcpy(scratch, s.c_str(), s.size());
+            rapidjson::Value result(rapidjson::StringRef(scratch, s.size()));
+            scratch += s.size();
+            return result;
+        };
+
         for (const Path &p : completedScenes)
-            completedValue.PushBack(JsonUtils::toJson(p, allocator), allocator);
+            completedValue.PushBack(pathRef(p), allocator);
         for (const Path &p : queuedScenes)
-            queuedValue.PushBack(JsonUtils::toJson(p, allocator), allocator);
+            queuedValue.PushBack(pathRef(p), allocator);
 
-        result.add("completed_scenes", std::move(completedValue),
+        result.add("current_scene", pathRef(currentScene),
+                   "completed_scenes", std::move(completedValue),
                    "queued_scenes", std::move(queuedValue));
 
         return result;
@@ -98,7 +243,7 @@ struct RendererStatus
 class StandaloneRenderer
 {
     CliParser &_parser;
-    std::ostream &_logStream;
+    RenderLog &_log;
 
     double _checkpointInterval;
     double _timeout;
@@ -106,30 +251,45 @@ class StandaloneRenderer
     Path _inputDirectory;
     Path _outputDirectory;
 
-    std::unique_ptr<Scene> _scene;
-    std::unique_ptr<TraceableScene> _flattenedScene;
+    // Shared so that readers (the framebuffer conversion) can hold a
+    // reference across a concurrent scene swap; the swap just publishes
+    // new pointers and the last user frees the old scene
+    std::shared_ptr<Scene> _scene;
+    std::shared_ptr<TraceableScene> _flattenedScene;
 
     std::mutex _statusMutex;
-    std::mutex _logMutex;
     std::mutex _sceneMutex;
     RendererStatus _status;
+    std::shared_ptr<const RendererStatus> _statusSnapshot;
+
+    std::mutex _statusJsonMutex;
+    std::shared_ptr<const RendererStatus> _statusJsonSource;
+    std::shared_ptr<const std::string> _statusJson;
 
     void writeLogLine(const std::string &s)
     {
-        std::unique_lock<std::mutex> lock(_logMutex);
-        _logStream << s << std::endl;
+        _log.writeLine(s);
+    }
+
+    // Publishes an immutable snapshot of _status for status queries.
+    // Expects _statusMutex to be held. The copy happens here, on the
+    // (infrequent) status changes, so queries only grab the shared_ptr
+    void publishStatus()
+    {
+        _statusSnapshot = std::make_shared<RendererStatus>(_status);
     }
 
 public:
-    StandaloneRenderer(CliParser &parser, std::ostream &logStream)
+    StandaloneRenderer(CliParser &parser, RenderLog &log)
     : _parser(parser),
-      _logStream(logStream),
+      _log(log),
       _checkpointInterval(0.0),
       _timeout(0.0),
       _threadCount(max(ThreadUtils::idealThreadCount() - 1, 1u))
     {
         _status.state = STATE_LOADING;
         _status.currentSpp = _status.nextSpp = _status.totalSpp = 0;
+        publishStatus();
 
         parser.addOption('h', "help", "Prints this help text", false, OPT_HELP);
         parser.addOption('v', "version", "Prints version information", false, OPT_VERSION);
@@ -184,8 +344,14 @@ public:
                 FileUtils::createDirectory(_outputDirectory, true);
         }
 
+        // The scene list is known up front, so size completedScenes for
+        // the whole batch once instead of reallocating and moving the
+        // accumulated paths every time a scene finishes. queuedScenes is
+        // a deque and needs no reserve
+        _status.completedScenes.reserve(_parser.operands().size());
         for (const std::string &p : _parser.operands())
             _status.queuedScenes.emplace_back(p);
+        publishStatus();
     }
 
     bool renderScene()
@@ -201,20 +367,21 @@ public:
 
             currentScene = _status.currentScene = _status.queuedScenes.front();
             _status.queuedScenes.pop_front();
+            publishStatus();
         }
 
         writeLogLine(tfm::format("Loading scene '%s'...", currentScene));
         Path inputDirectory = _parser.isPresent(OPT_INPUT_DIRECTORY) ? _inputDirectory : Path(currentScene).parent();
         try {
+            // Load outside the lock; only publishing the pointer needs it
+            std::shared_ptr<Scene> scene(Scene::load(Path(currentScene), nullptr, &inputDirectory));
+            scene->loadResources();
+
             std::unique_lock<std::mutex> lock(_sceneMutex);
-            _scene.reset(Scene::load(Path(currentScene), nullptr, &inputDirectory));
-            _scene->loadResources();
+            _scene = std::move(scene);
         } catch (const JsonLoadException &e) {
             std::cerr << e.what() << std::endl;
 
-            std::unique_lock<std::mutex> lock(_sceneMutex);
-            _scene.reset();
-
             return true;
         }
 
@@ -235,6 +402,7 @@ public:
         {
             std::unique_lock<std::mutex> lock(_statusMutex);
             _status.totalSpp = _scene->rendererSettings().spp();
+            publishStatus();
         }
 
         try {
@@ -249,8 +417,9 @@ public:
 
             int maxSpp = _scene->rendererSettings().spp();
             {
+                std::shared_ptr<TraceableScene> flattenedScene(_scene->makeTraceable(seed));
                 std::unique_lock<std::mutex> lock(_sceneMutex);
-                _flattenedScene.reset(_scene->makeTraceable(seed));
+                _flattenedScene = std::move(flattenedScene);
             }
             Integrator &integrator = _flattenedScene->integrator();
             bool resumeRender = _scene->rendererSettings().enableResumeRender();
@@ -274,6 +443,7 @@ public:
                 {
                     std::unique_lock<std::mutex> lock(_statusMutex);
                     _status.startSpp = integrator.currentSpp();
+                    publishStatus();
                 }
             }
 
@@ -286,6 +456,7 @@ public:
                     _status.state = STATE_RENDERING;
                     _status.currentSpp = integrator.currentSpp();
                     _status.nextSpp = integrator.nextSpp();
+                    publishStatus();
                 }
 
                 integrator.startRender([](){});
@@ -321,6 +492,7 @@ public:
             {
                 std::unique_lock<std::mutex> lock(_statusMutex);
                 _status.completedScenes.push_back(currentScene);
+                publishStatus();
             }
         } catch (std::runtime_error &e) {
             writeLogLine(tfm::format("Renderer for file '%s' encountered an unrecoverable error: \n%s",
@@ -336,30 +508,97 @@ public:
         return true;
     }
 
-    RendererStatus status()
+    std::shared_ptr<const RendererStatus> status()
     {
         std::unique_lock<std::mutex> lock(_statusMutex);
-        RendererStatus copy(_status);
-        return std::move(copy);
+        return _statusSnapshot;
     }
 
-    std::mutex &logMutex()
+    // Returns the serialized form of the current status. The string is
+    // interned per status snapshot: it is built once when the status has
+    // changed since the last query, and repeat queries for the same
+    // snapshot share the cached string without allocating
+    std::shared_ptr<const std::string> statusJson()
     {
-        return _logMutex;
+        std::shared_ptr<const RendererStatus> current = status();
+        if (!current)
+            return nullptr;
+
+        std::unique_lock<std::mutex> lock(_statusJsonMutex);
+        if (current != _statusJsonSource) {
+            rapidjson::Document document;
+            *(static_cast<rapidjson::Value *>(&document)) = current->toJson(document.GetAllocator());
+
+            rapidjson::GenericStringBuffer<rapidjson::UTF8<>> buffer;
+            rapidjson::Writer<rapidjson::GenericStringBuffer<rapidjson::UTF8<>>> jsonWriter(buffer);
+            document.Accept(jsonWriter);
+
+            _statusJson = std::make_shared<std::string>(buffer.GetString(), buffer.GetSize());
+            _statusJsonSource = std::move(current);
+        }
+        return _statusJson;
     }
 
     std::unique_ptr<Vec3c[]> frameBuffer(Vec2i &resolution)
     {
-        std::unique_lock<std::mutex> lock(_sceneMutex);
-        if (!_scene || !_flattenedScene)
+        // Take shared references under a brief lock and convert without
+        // holding it, so a slow conversion never blocks the render loop's
+        // scene swaps. If the scene is torn down concurrently, these
+        // references keep it alive until we're done
+        std::shared_ptr<Scene> scene;
+        std::shared_ptr<TraceableScene> flattenedScene;
+        {
+            std::unique_lock<std::mutex> lock(_sceneMutex);
+            scene = _scene;
+            flattenedScene = _flattenedScene;
+        }
+        if (!scene || !flattenedScene)
             return nullptr;
 
-        Vec2u res = _scene->camera()->resolution();
+        Vec2u res = scene->camera()->resolution();
         std::unique_ptr<Vec3c[]> ldr(new Vec3c[res.product()]);
 
-        for (uint32 y = 0; y < res.y(); ++y)
-            for (uint32 x = 0; x < res.x(); ++x)
-                ldr[x + y*res.x()] = Vec3c(clamp(Vec3i(_scene->camera()->get(x, y)*255.0f), Vec3i(0), Vec3i(255)));
+        // Tonemap into a flat float staging buffer first, so the float->byte
+        // conversion below runs over one contiguous stream instead of being
+        // interleaved with per-pixel framebuffer fetches. Both buffers are
+        // swept start to finish, so huge pages keep the sweeps from
+        // thrashing the TLB at high resolutions.
+        // The sweep runs serially on the calling thread: this is called
+        // from HTTP worker threads, and ThreadPool::yield work-steals
+        // queued render subtasks onto callers from outside the pool with
+        // a thread id the integrators don't size their per-thread state
+        // for, so the render pool must not be entered from here
+        uint32 numValues = res.product()*3;
+        std::unique_ptr<float[]> staging(new float[numValues]);
+        adviseHugePages(ldr.get(), res.product()*sizeof(Vec3c));
+        adviseHugePages(staging.get(), numValues*sizeof(float));
+        for (uint32 y = 0; y < res.y(); ++y) {
+            for (uint32 x = 0; x < res.x(); ++x) {
+                Vec3f c = scene->camera()->get(x, y);
+                float *dst = &staging[3*(x + y*res.x())];
+                dst[0] = c.x();
+                dst[1] = c.y();
+                dst[2] = c.z();
+            }
+        }
+
+        // Scale, truncate and saturate sixteen values per iteration. The
+        // packs/packus chain clamps to [0, 255] as part of the narrowing,
+        // so no separate min/max (or per-component branches) are needed.
+        // Matches the scalar Vec3c(clamp(Vec3i(c*255.0f), ...)) conversion
+        uint8 *bytes = &ldr[0].x();
+        const __m128 scale = _mm_set1_ps(255.0f);
+        uint32 simdEnd = numValues & ~15u;
+        for (uint32 i = 0; i < simdEnd; i += 16) {
+            __m128i q0 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&staging[i +  0]), scale));
+            __m128i q1 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&staging[i +  4]), scale));
+            __m128i q2 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&staging[i +  8]), scale));
+            __m128i q3 = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&staging[i + 12]), scale));
+            __m128i q = _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&bytes[i]), q);
+        }
+        for (uint32 i = simdEnd; i < numValues; ++i)
+            bytes[i] = uint8(clamp(int(staging[i]*255.0f), 0, 255));
 
         resolution = Vec2i(res);
 
@@ -7,7 +7,8 @@ int main(int argc, const char *argv[])
 {
     CliParser parser("tungsten", "[options] scene1 [scene2 [scene3...]]");
 
-    StandaloneRenderer renderer(parser, std::cout);
+    RenderLog log(&std::cout);
+    StandaloneRenderer renderer(parser, log);
 
     parser.parse(argc, argv);
 